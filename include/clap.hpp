@@ -321,7 +321,7 @@ void clargparser::SimpleCommandLineArgumentParser::parse(int argc, char** argv)
 
     for (int i = 1; i < argc; i++) {
         if (strlen(argv[i]) > 1 && argv[i][0] == '-') {
-            if (argv[i][2] == '-') {
+            if (argv[i][1] == '-') {
                 // named arg
                 std::string argName = argv[i]+2; // ignore first 2 chars
                 auto xpct = std::find(expectations.begin(), expectations.end(), argv[i]);
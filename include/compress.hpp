@@ -0,0 +1,100 @@
+#ifndef INCLUDE_COMPRESS_HPP_HEADER_GUARD_61730418825093
+#define INCLUDE_COMPRESS_HPP_HEADER_GUARD_61730418825093
+
+#include <string>
+#include <ostream>
+#include <deque>
+#include <map>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+namespace compression {
+
+    enum class Codec {
+        NONE,
+        GZIP,
+        ZSTD,
+        INVALID
+    };
+
+    struct Settings {
+        Codec codec = Codec::NONE;
+        int level = 0;
+        unsigned threads = 1;
+        size_t blockSize = 1 << 20;
+    };
+
+    /**
+     * Parse a spec of the form codec[:level], e.g. "gzip", "zstd:19". Returns
+     * false (and leaves settings alone) if the spec is malformed or names a
+     * codec this build doesn't support.
+     */
+    bool parseSpec(const std::string & spec, Settings & settings, std::string & error);
+
+    const char* codecName(Codec codec);
+
+    /**
+     * Compresses independent blocks of text on a pool of threads and writes
+     * them to the underlying stream in submission order. Every block becomes
+     * a complete gzip member or zstd frame, so the output is a valid
+     * multi-member/multi-frame stream that the stock tools decompress as one.
+     *
+     * At most 2 * threads blocks are in flight at any time; write() blocks
+     * until there's room, which keeps memory bounded no matter how much is
+     * generated.
+     */
+    class BlockWriter {
+        public:
+            BlockWriter(std::ostream & out, const Settings & settings);
+            ~BlockWriter();
+
+            /**
+             * Queue a block for compression. Flushes finished blocks to the
+             * output stream as a side effect.
+             */
+            void write(std::string block);
+
+            /**
+             * Wait for all queued blocks, write them and stop the workers. If
+             * nothing was written, a single empty block is written instead so
+             * the output is still a valid stream.
+             * Returns false if any block failed to compress.
+             */
+            bool finish();
+        private:
+            struct Job {
+                size_t seq;
+                std::string data;
+            };
+
+            std::ostream & out;
+            Settings settings;
+
+            std::vector<std::thread> workers;
+            std::deque<Job> pending;
+            std::map<size_t, std::string> done;
+            size_t nextSeq = 0;
+            size_t nextWrite = 0;
+            bool stopping = false;
+            bool failed = false;
+            bool finished = false;
+
+            std::mutex lock;
+            std::condition_variable jobReady;
+            std::condition_variable jobDone;
+
+            void work();
+
+            /**
+             * Helper function: Write every finished block which is next in
+             * line. Expects lock to be held.
+             */
+            void drain(std::unique_lock<std::mutex> & held);
+
+            bool compressBlock(const std::string & in, std::string & out) const;
+    };
+}
+
+#endif /* INCLUDE_COMPRESS_HPP_HEADER_GUARD_61730418825093 */
@@ -0,0 +1,40 @@
+#ifndef INCLUDE_VERIFY_HPP_HEADER_GUARD_90412675330218
+#define INCLUDE_VERIFY_HPP_HEADER_GUARD_90412675330218
+
+#include <string>
+
+namespace verification {
+
+    enum class Kind {
+        INTEGER,
+        DOUBLE,
+        STRING
+    };
+
+    /**
+     * What a generated file is supposed to look like - the same parameters
+     * that were passed when generating it.
+     *
+     * For integers and doubles, low and limit bound the values; for strings
+     * they bound the line lengths and charClass (e.g. isalpha) decides which
+     * characters may appear.
+     */
+    struct Spec {
+        Kind kind = Kind::INTEGER;
+        long long nsamples = 0;
+        double low = 0;
+        double limit = 0;
+        int (*charClass)(int) = nullptr;
+        const char* className = "";
+        unsigned threads = 1;
+    };
+
+    /**
+     * Map the file, check it against spec on spec.threads threads and print a
+     * report (problems plus a min/max/mean/histogram summary) to stdout.
+     * Returns true if the file matches the spec.
+     */
+    bool verifyFile(const std::string & file, const Spec & spec);
+}
+
+#endif /* INCLUDE_VERIFY_HPP_HEADER_GUARD_90412675330218 */
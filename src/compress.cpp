@@ -0,0 +1,165 @@
+#include "compress.hpp"
+#include <cstdlib>
+#include <zlib.h>
+#ifdef GENTEST_WITH_ZSTD
+#include <zstd.h>
+#endif
+
+
+const char* compression::codecName(Codec codec) {
+    switch (codec) {
+        case Codec::NONE: return "none";
+        case Codec::GZIP: return "gzip";
+        case Codec::ZSTD: return "zstd";
+        default: return "invalid";
+    }
+}
+
+bool compression::parseSpec(const std::string & spec, Settings & settings, std::string & error) {
+    auto colon = spec.find(':');
+    std::string name = spec.substr(0, colon);
+
+    Codec codec = name=="gzip" ? Codec::GZIP : name=="zstd" ? Codec::ZSTD : Codec::INVALID;
+    if (codec == Codec::INVALID) {
+        error = "unknown compression codec " + name + " (expected gzip or zstd)";
+        return false;
+    }
+#ifndef GENTEST_WITH_ZSTD
+    if (codec == Codec::ZSTD) {
+        error = "zstd support not compiled in (rebuild with make WITH_ZSTD=1)";
+        return false;
+    }
+#endif
+
+    int level = codec == Codec::GZIP ? 6 : 3;
+    if (colon != std::string::npos) {
+        std::string levelString = spec.substr(colon + 1);
+        char* end;
+        long l = strtol(levelString.c_str(), &end, 10);
+        int maxLevel = codec == Codec::GZIP ? 9 : 22;
+        if (levelString.empty() || *end != '\0' || l < 1 || l > maxLevel) {
+            error = "invalid " + name + " level " + levelString + " (expected 1-" + std::to_string(maxLevel) + ")";
+            return false;
+        }
+        level = (int)l;
+    }
+
+    settings.codec = codec;
+    settings.level = level;
+    return true;
+}
+
+// block writer
+
+compression::BlockWriter::BlockWriter(std::ostream & out, const Settings & settings) : out(out), settings(settings) {
+    unsigned n = settings.threads > 0 ? settings.threads : 1;
+    for (unsigned i = 0; i < n; i++) {
+        workers.push_back(std::thread(&BlockWriter::work, this));
+    }
+}
+
+compression::BlockWriter::~BlockWriter() {
+    finish();
+}
+
+void compression::BlockWriter::write(std::string block) {
+    if (block.empty()) return;
+
+    std::unique_lock<std::mutex> held(lock);
+    size_t limit = 2 * workers.size();
+    while (nextSeq - nextWrite >= limit) {
+        drain(held);
+        if (nextSeq - nextWrite >= limit) jobDone.wait(held);
+    }
+    pending.push_back(Job{nextSeq++, std::move(block)});
+    jobReady.notify_one();
+    drain(held);
+}
+
+bool compression::BlockWriter::finish() {
+    if (finished) return !failed;
+
+    {
+        std::unique_lock<std::mutex> held(lock);
+        // no data at all still has to be a valid stream: one empty member/frame
+        if (nextSeq == 0) {
+            pending.push_back(Job{nextSeq++, std::string()});
+            jobReady.notify_one();
+        }
+        while (nextWrite < nextSeq) {
+            drain(held);
+            if (nextWrite < nextSeq) jobDone.wait(held);
+        }
+        stopping = true;
+    }
+    jobReady.notify_all();
+    for (auto it = workers.begin(); it != workers.end(); it++) {
+        it->join();
+    }
+    out.flush();
+    finished = true;
+    return !failed && out.good();
+}
+
+void compression::BlockWriter::work() {
+    std::unique_lock<std::mutex> held(lock);
+    while (true) {
+        while (pending.empty() && !stopping) jobReady.wait(held);
+        if (pending.empty()) return;
+
+        Job job = std::move(pending.front());
+        pending.pop_front();
+
+        held.unlock();
+        std::string compressed;
+        bool ok = compressBlock(job.data, compressed);
+        held.lock();
+
+        if (!ok) failed = true;
+        done[job.seq] = std::move(compressed);
+        jobDone.notify_all();
+    }
+}
+
+void compression::BlockWriter::drain(std::unique_lock<std::mutex> & held) {
+    // write outside the lock so the workers can keep publishing results
+    auto it = done.find(nextWrite);
+    while (it != done.end()) {
+        std::string data = std::move(it->second);
+        done.erase(it);
+        held.unlock();
+        out.write(data.data(), data.size());
+        held.lock();
+        nextWrite++;
+        it = done.find(nextWrite);
+    }
+}
+
+bool compression::BlockWriter::compressBlock(const std::string & in, std::string & out) const {
+    if (settings.codec == Codec::GZIP) {
+        z_stream zs = z_stream();
+        // windowBits 15 + 16 makes zlib emit a full gzip member (header + trailer)
+        if (deflateInit2(&zs, settings.level, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+            return false;
+        }
+        out.resize(deflateBound(&zs, in.size()) + 32);
+        zs.next_in = (Bytef*)in.data();
+        zs.avail_in = in.size();
+        zs.next_out = (Bytef*)&out[0];
+        zs.avail_out = out.size();
+        int ret = deflate(&zs, Z_FINISH);
+        out.resize(zs.total_out);
+        deflateEnd(&zs);
+        return ret == Z_STREAM_END;
+    }
+#ifdef GENTEST_WITH_ZSTD
+    if (settings.codec == Codec::ZSTD) {
+        out.resize(ZSTD_compressBound(in.size()));
+        size_t written = ZSTD_compress(&out[0], out.size(), in.data(), in.size(), settings.level);
+        if (ZSTD_isError(written)) return false;
+        out.resize(written);
+        return true;
+    }
+#endif
+    return false;
+}
@@ -2,11 +2,16 @@
 #include <cstdlib>
 #include <ctime>
 #include "clap.hpp"
+#include "compress.hpp"
+#include "verify.hpp"
 #include <fstream>
+#include <sstream>
+#include <thread>
 
 
 const char* progname;
 bool verbose;
+compression::Settings compressSettings;
 
 enum class Type {
     ALNUM,
@@ -64,6 +69,13 @@ void usage() {
 
         printf ("  -v                Print more information about generated data\n");
         printf("   --verbose\n\n");
+
+        printf("  --compress <codec[:level]>  Compress output with gzip or zstd, one block per thread\n\n");
+
+        printf("  --threads <n>      Number of compression/verification threads - default all cores\n\n");
+
+        printf("  --verify           Check an existing file against the other options instead of\n");
+        printf("                     generating it\n\n");
         
         exit (0);
 }
@@ -72,8 +84,15 @@ void generateDoubles(const std::string & outputfile, int nsamples, double low, d
 void generateStrings(const std::string & outputfile, int nsamples, int low, int limit, Type type);
 void generateIntegers(const std::string & outputfile, int nsamples, int low, int limit);
 
+template <typename GenFunc, typename ArgType>
+void writeCompressed(const std::string & outputfile, int nsamples, GenFunc genfunc, ArgType lowLimit, ArgType limit);
+
 template <typename GenFunc, typename ArgType>
 void writeToFile(const std::string & outputfile, int nsamples, GenFunc genfunc, ArgType lowLimit, ArgType limit) {
+    if (compressSettings.codec != compression::Codec::NONE) {
+        writeCompressed(outputfile, nsamples, genfunc, lowLimit, limit);
+        return;
+    }
     std::ofstream file(outputfile);
     for (int i = 0; i < nsamples; i++) {
         file << genfunc(lowLimit, limit) << std::endl;
@@ -81,6 +100,28 @@ void writeToFile(const std::string & outputfile, int nsamples, GenFunc genfunc,
     file.close();
 }
 
+// Generation stays on this thread (rand() isn't thread safe, and a single
+// generator keeps the output identical to the plain path); only compression
+// is farmed out, one block at a time.
+template <typename GenFunc, typename ArgType>
+void writeCompressed(const std::string & outputfile, int nsamples, GenFunc genfunc, ArgType lowLimit, ArgType limit) {
+    std::ofstream file(outputfile, std::ios::binary);
+    compression::BlockWriter writer(file, compressSettings);
+    std::ostringstream block;
+    for (int i = 0; i < nsamples; i++) {
+        block << genfunc(lowLimit, limit) << '\n';
+        if ((size_t)block.tellp() >= compressSettings.blockSize) {
+            writer.write(block.str());
+            block.str("");
+        }
+    }
+    writer.write(block.str());
+    if (!writer.finish()) {
+        fprintf(stderr, "Error: failed to write compressed output to %s\n", outputfile.c_str());
+        exit(1);
+    }
+}
+
 int intgen(int lowLimit, int limit) {
     int diff = limit - lowLimit;
     return lowLimit + (rand() % diff);
@@ -98,30 +139,32 @@ char charFromFunc(int (*func)(int)) {
     return (char)ch;
 }
 
-char chargen(Type type) {
-    char ch;
+int (*classFunc(Type type))(int) {
     switch (type) {
-        case Type::ALNUM: ch = charFromFunc(isalnum); break;
-        case Type::ALPHA: ch = charFromFunc(isalpha); break;
-        case Type::BLANK: ch = charFromFunc(isblank); break;
-        case Type::CNTRL: ch = charFromFunc(iscntrl); break;
-        case Type::DIGIT: ch = charFromFunc(isdigit); break;
-        case Type::GRAPH: ch = charFromFunc(isgraph); break;
-        case Type::LOWER: ch = charFromFunc(islower); break;
-        case Type::PRINT: ch = charFromFunc(isprint); break;
-        case Type::PUNCT: ch = charFromFunc(ispunct); break;
-        case Type::SPACE: ch = charFromFunc(isspace); break;
-        case Type::UPPER: ch = charFromFunc(isupper); break;
-        case Type::XDIGIT: ch = charFromFunc(isxdigit); break;
+        case Type::ALNUM: return isalnum;
+        case Type::ALPHA: return isalpha;
+        case Type::BLANK: return isblank;
+        case Type::CNTRL: return iscntrl;
+        case Type::DIGIT: return isdigit;
+        case Type::GRAPH: return isgraph;
+        case Type::LOWER: return islower;
+        case Type::PRINT: return isprint;
+        case Type::PUNCT: return ispunct;
+        case Type::SPACE: return isspace;
+        case Type::UPPER: return isupper;
+        case Type::XDIGIT: return isxdigit;
         default: fprintf(stderr, "Error: invalid char type %s\n", STRING_FROM_TYPE(type)); exit(0);
     }
-    return ch;
+}
+
+char chargen(Type type) {
+    return charFromFunc(classFunc(type));
 }
 
 std::string stringgen(int lowLimit, int lenlimit, Type type) {
-    int actualLength = rand() % lenlimit;
+    int actualLength = lowLimit + rand() % (lenlimit - lowLimit);
     std::string ret;
-    for (int i = -lowLimit; i < actualLength; i++) {
+    for (int i = 0; i < actualLength; i++) {
         ret += chargen(type);
     }
     return ret;
@@ -146,7 +189,7 @@ int main(int argc, char** argv) {
     srand(time(NULL));
     
     clargparser::SimpleCommandLineArgumentParser clap;
-    clap.expect("-o %s | input.txt; -t %s | alpha; -n %d ? integer expected; -e %d | 1000 ? integer expected; -b %d | 1 ? integer expected; -i; -d; -s; -v");
+    clap.expect("-o %s | input.txt; -t %s | alpha; -n %d ? integer expected; -e %d | 1000 ? integer expected; -b %d | 1 ? integer expected; -i; -d; -s; -v; --verbose; --compress %s ? codec expected (gzip or zstd[:level]); --threads %d ? integer expected; --verify");
     clap.parse(argc, argv);
 
     if (clap.hasError()) {
@@ -169,8 +212,47 @@ int main(int argc, char** argv) {
         clap.get("-b", lowLimit);
         clap.get("-e", limit);
         verbose = clap.hasShort('v') || clap.hasNamed("verbose");
-        
-        if (clap.hasShort('d')) {
+
+        std::string compressSpec, compressError;
+        if (clap.get("compress", compressSpec) && !compression::parseSpec(compressSpec, compressSettings, compressError)) {
+            printf("Error: %s\n", compressError.c_str());
+            usage();
+        }
+        int threads = 0;
+        if (!clap.get("threads", threads) || threads < 1) {
+            threads = std::thread::hardware_concurrency();
+        }
+        compressSettings.threads = threads > 0 ? threads : 1;
+
+        if (clap.hasShort('s') && !clap.hasShort('d') && limit <= lowLimit) {
+            printf("Error: string length limit (-e) must be greater than lowest length (-b)\n");
+            usage();
+        }
+
+        if (clap.hasNamed("verify")) {
+            if (compressSettings.codec != compression::Codec::NONE) {
+                printf("Error: cannot verify compressed files, decompress first\n");
+                usage();
+            }
+            verification::Spec spec;
+            spec.nsamples = nsamples;
+            spec.low = lowLimit;
+            spec.limit = limit;
+            spec.threads = compressSettings.threads;
+            if (clap.hasShort('d')) {
+                spec.kind = verification::Kind::DOUBLE;
+            }
+            else if (clap.hasShort('s')) {
+                std::string type;
+                clap.get("-t", type);
+                Type t = TYPE_FROM_STRING(type);
+                spec.kind = verification::Kind::STRING;
+                spec.charClass = classFunc(t);
+                spec.className = STRING_FROM_TYPE(t);
+            }
+            return verification::verifyFile(outputfile, spec) ? 0 : 1;
+        }
+        else if (clap.hasShort('d')) {
             generateDoubles(outputfile, nsamples, (double)lowLimit, (double)limit);
         }
         else if (clap.hasShort('s')) {
@@ -189,6 +271,9 @@ int main(int argc, char** argv) {
 void generateDoubles(const std::string & outputfile, int nsamples, double lowLimit, double limit) {
     if (verbose) {
         printf("Writing doubles to file %s\n", outputfile.c_str());
+        if (compressSettings.codec != compression::Codec::NONE) {
+            printf("Compression: %s level %d, %u threads\n", compression::codecName(compressSettings.codec), compressSettings.level, compressSettings.threads);
+        }
         printf("Number of samples: %d\n", nsamples);
         printf("Range: [%g, %g)\n", lowLimit, limit);
     }
@@ -197,6 +282,9 @@ void generateDoubles(const std::string & outputfile, int nsamples, double lowLim
 void generateStrings(const std::string & outputfile, int nsamples, int lowLimit, int limit, Type type) {
     if (verbose) {
         printf("Writing strings to file %s\n", outputfile.c_str());
+        if (compressSettings.codec != compression::Codec::NONE) {
+            printf("Compression: %s level %d, %u threads\n", compression::codecName(compressSettings.codec), compressSettings.level, compressSettings.threads);
+        }
         printf("Include characters: %s\n", STRING_FROM_TYPE(type));
         printf("Number of samples: %d\n", nsamples);
         printf("Length range: [%d, %d)\n", lowLimit, limit);
@@ -206,6 +294,9 @@ void generateStrings(const std::string & outputfile, int nsamples, int lowLimit,
 void generateIntegers(const std::string & outputfile, int nsamples, int lowLimit, int limit) {
     if (verbose) {
         printf("Writing integers to file %s\n", outputfile.c_str());
+        if (compressSettings.codec != compression::Codec::NONE) {
+            printf("Compression: %s level %d, %u threads\n", compression::codecName(compressSettings.codec), compressSettings.level, compressSettings.threads);
+        }
         printf("Number of samples: %d\n", nsamples);
         printf("Range: [%d, %d)\n", lowLimit, limit);
     }
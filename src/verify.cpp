@@ -0,0 +1,320 @@
+#include "verify.hpp"
+#include <cerrno>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <functional>
+#include <vector>
+#include <thread>
+#include <utility>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+
+namespace {
+
+    const size_t histogramBuckets = 10;
+    const size_t maxReportedProblems = 10;
+
+    struct Problem {
+        size_t line; // local to the chunk until the results are merged
+        std::string message;
+    };
+
+    struct ChunkResult {
+        size_t lines = 0;
+        size_t unparsable = 0;
+        size_t outOfRange = 0;
+        size_t badChars = 0;
+        size_t counted = 0; // lines that contributed to the statistics
+        double min = 0;
+        double max = 0;
+        double sum = 0;
+        std::vector<size_t> histogram = std::vector<size_t>(histogramBuckets);
+        std::vector<Problem> problems;
+    };
+
+    /**
+     * Allowed characters, both as a lookup table and as runs of consecutive
+     * codes so that 16 bytes at a time can be checked with a few compares.
+     * The generator only ever emits codes 0-127, so that's all that's allowed.
+     */
+    struct CharClass {
+        bool table[256];
+        std::vector<std::pair<int, int> > runs;
+
+        explicit CharClass(int (*func)(int)) {
+            memset(table, 0, sizeof(table));
+            for (int c = 0; c < 128; c++) {
+                table[c] = func && func(c);
+                if (!table[c]) continue;
+                if (!runs.empty() && runs.back().second == c - 1) runs.back().second = c;
+                else runs.push_back(std::make_pair(c, c));
+            }
+        }
+    };
+
+#ifdef __SSE2__
+    // Bit i set if byte i of x is in cls. Signed compares: bytes >= 128 are
+    // negative and never fall in a run
+    int classMask(__m128i x, const CharClass & cls) {
+        __m128i ok = _mm_setzero_si128();
+        for (auto it = cls.runs.begin(); it != cls.runs.end(); it++) {
+            __m128i aboveLow = _mm_cmpgt_epi8(x, _mm_set1_epi8((char)(it->first - 1)));
+            __m128i aboveHigh = _mm_cmpgt_epi8(x, _mm_set1_epi8((char)it->second));
+            ok = _mm_or_si128(ok, _mm_andnot_si128(aboveHigh, aboveLow));
+        }
+        return _mm_movemask_epi8(ok);
+    }
+#endif
+
+    // Returns the offset of the first character not in cls, or n
+    size_t findBadChar(const unsigned char* p, size_t n, const CharClass & cls) {
+        size_t i = 0;
+#ifdef __SSE2__
+        for (; i + 16 <= n; i += 16) {
+            int mask = classMask(_mm_loadu_si128((const __m128i*)(p + i)), cls);
+            if (mask != 0xFFFF) return i + __builtin_ctz(~mask);
+        }
+#endif
+        for (; i < n; i++) {
+            if (!cls.table[p[i]]) return i;
+        }
+        return n;
+    }
+
+    size_t countBadChars(const unsigned char* p, size_t n, const CharClass & cls) {
+        size_t i = 0, count = 0;
+#ifdef __SSE2__
+        for (; i + 16 <= n; i += 16) {
+            int mask = classMask(_mm_loadu_si128((const __m128i*)(p + i)), cls);
+            count += __builtin_popcount(~mask & 0xFFFF);
+        }
+#endif
+        for (; i < n; i++) {
+            count += !cls.table[p[i]];
+        }
+        return count;
+    }
+
+    bool parseInteger(const char* p, const char* end, double & value) {
+        bool negative = p < end && *p == '-';
+        if (negative) p++;
+        if (p == end || end - p > 18) return false;
+        long long v = 0;
+        for (; p < end; p++) {
+            if (*p < '0' || *p > '9') return false;
+            v = v * 10 + (*p - '0');
+        }
+        value = (double)(negative ? -v : v);
+        return true;
+    }
+
+    bool parseDouble(const char* p, const char* end, double & value) {
+        // strtod needs a terminator, and the mapping doesn't have one
+        char buf[64];
+        size_t len = end - p;
+        if (len == 0 || len >= sizeof(buf)) return false;
+        memcpy(buf, p, len);
+        buf[len] = '\0';
+        char* parsedEnd;
+        value = strtod(buf, &parsedEnd);
+        return parsedEnd == buf + len;
+    }
+
+    // Formatting messages nobody will see is most of the cost on a bad file
+    bool wantsProblems(const ChunkResult & result) {
+        return result.problems.size() < maxReportedProblems;
+    }
+
+    void addProblem(ChunkResult & result, const char* message) {
+        result.problems.push_back(Problem{result.lines, message});
+    }
+
+    void checkChunk(const char* begin, const char* end, const verification::Spec & spec, const CharClass & cls, ChunkResult & result) {
+        char msg[128];
+        const char* line = begin;
+
+        // doubles are written with 6 significant digits, so a printed value
+        // can be off by half a unit in the 6th digit of the largest bound
+        double slack = 0;
+        double magnitude = std::max(std::fabs(spec.low), std::fabs(spec.limit));
+        if (spec.kind == verification::Kind::DOUBLE && magnitude > 0) {
+            slack = 0.5 * std::pow(10.0, std::floor(std::log10(magnitude)) - 5);
+        }
+
+        while (line < end) {
+            const char* eol = (const char*)memchr(line, '\n', end - line);
+            if (!eol) eol = end;
+            result.lines++;
+
+            double value;
+            bool parsed = true;
+            if (spec.kind == verification::Kind::INTEGER) {
+                parsed = parseInteger(line, eol, value);
+            }
+            else if (spec.kind == verification::Kind::DOUBLE) {
+                parsed = parseDouble(line, eol, value);
+            }
+            else {
+                value = (double)(eol - line);
+                const unsigned char* p = (const unsigned char*)line;
+                size_t n = eol - line;
+                size_t bad = findBadChar(p, n, cls);
+                if (bad < n) {
+                    if (wantsProblems(result)) {
+                        snprintf(msg, sizeof(msg), "character 0x%02x at column %zu is not %s", p[bad], bad + 1, spec.className);
+                        addProblem(result, msg);
+                    }
+                    result.badChars += countBadChars(p + bad, n - bad, cls);
+                }
+            }
+
+            if (!parsed) {
+                result.unparsable++;
+                if (wantsProblems(result)) {
+                    snprintf(msg, sizeof(msg), "cannot parse \"%.*s\"", (int)std::min<size_t>(eol - line, 32), line);
+                    addProblem(result, msg);
+                }
+            }
+            else {
+                // doublegen can return the limit itself, so that's allowed too
+                bool inRange = value >= spec.low - slack &&
+                    (spec.kind == verification::Kind::DOUBLE ? value <= spec.limit + slack : value < spec.limit);
+                if (!inRange) {
+                    result.outOfRange++;
+                    if (wantsProblems(result)) {
+                        snprintf(msg, sizeof(msg), "%s %g out of range", spec.kind == verification::Kind::STRING ? "length" : "value", value);
+                        addProblem(result, msg);
+                    }
+                }
+
+                if (result.counted == 0 || value < result.min) result.min = value;
+                if (result.counted == 0 || value > result.max) result.max = value;
+                result.sum += value;
+                result.counted++;
+                if (inRange && spec.limit > spec.low) {
+                    double position = std::max(0.0, (value - spec.low) / (spec.limit - spec.low));
+                    size_t bucket = (size_t)(position * histogramBuckets);
+                    result.histogram[std::min(bucket, histogramBuckets - 1)]++;
+                }
+            }
+
+            line = eol + 1;
+        }
+    }
+}
+
+bool verification::verifyFile(const std::string & file, const Spec & spec) {
+    int fd = open(file.c_str(), O_RDONLY);
+    if (fd < 0) {
+        printf("Error: cannot open %s: %s\n", file.c_str(), strerror(errno));
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        printf("Error: cannot stat %s: %s\n", file.c_str(), strerror(errno));
+        close(fd);
+        return false;
+    }
+
+    size_t size = st.st_size;
+    const char* data = nullptr;
+    if (size > 0) {
+        void* mapping = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (mapping == MAP_FAILED) {
+            printf("Error: cannot map %s: %s\n", file.c_str(), strerror(errno));
+            close(fd);
+            return false;
+        }
+        madvise(mapping, size, MADV_SEQUENTIAL);
+        data = (const char*)mapping;
+    }
+    close(fd);
+
+    // split into one chunk per thread, moving each boundary past the next
+    // newline so that no line is cut in two
+    unsigned nthreads = spec.threads > 0 ? spec.threads : 1;
+    std::vector<size_t> bounds(1, 0);
+    for (unsigned i = 1; i < nthreads; i++) {
+        size_t pos = std::max(bounds.back(), size / nthreads * i);
+        if (pos == 0 || pos >= size) break;
+        const char* eol = (const char*)memchr(data + pos - 1, '\n', size - pos + 1);
+        if (!eol) break;
+        pos = eol + 1 - data;
+        if (pos > bounds.back() && pos < size) bounds.push_back(pos);
+    }
+    bounds.push_back(size);
+
+    CharClass cls(spec.charClass);
+    std::vector<ChunkResult> results(bounds.size() - 1);
+    std::vector<std::thread> workers;
+    for (size_t i = 0; i + 1 < bounds.size(); i++) {
+        workers.push_back(std::thread(checkChunk, data + bounds[i], data + bounds[i + 1], std::cref(spec), std::cref(cls), std::ref(results[i])));
+    }
+    for (auto it = workers.begin(); it != workers.end(); it++) {
+        it->join();
+    }
+    if (data) munmap((void*)data, size);
+
+    // merge
+    ChunkResult total;
+    std::vector<Problem> problems;
+    for (auto it = results.begin(); it != results.end(); it++) {
+        for (auto p = it->problems.begin(); p != it->problems.end(); p++) {
+            if (problems.size() < maxReportedProblems) problems.push_back(Problem{total.lines + p->line, p->message});
+        }
+        total.lines += it->lines;
+        total.unparsable += it->unparsable;
+        total.outOfRange += it->outOfRange;
+        total.badChars += it->badChars;
+        if (it->counted > 0) {
+            if (total.counted == 0 || it->min < total.min) total.min = it->min;
+            if (total.counted == 0 || it->max > total.max) total.max = it->max;
+            total.sum += it->sum;
+            total.counted += it->counted;
+        }
+        for (size_t b = 0; b < histogramBuckets; b++) {
+            total.histogram[b] += it->histogram[b];
+        }
+    }
+
+    bool countOk = (long long)total.lines == spec.nsamples;
+    bool ok = countOk && total.unparsable == 0 && total.outOfRange == 0 && total.badChars == 0;
+
+    printf("Verifying %s (%zu bytes, %zu threads)\n", file.c_str(), size, results.size());
+    if (spec.kind == Kind::STRING && spec.charClass && spec.charClass('\n')) {
+        printf("Warning: newline is a %s character, so line-based checks may be off\n", spec.className);
+    }
+    for (auto p = problems.begin(); p != problems.end(); p++) {
+        printf("  line %zu: %s\n", p->line, p->message.c_str());
+    }
+    printf("Samples: %zu (expected %lld)%s\n", total.lines, spec.nsamples, countOk ? "" : " - MISMATCH");
+    if (spec.kind != Kind::STRING) printf("Unparsable: %zu\n", total.unparsable);
+    printf("Out of range: %zu\n", total.outOfRange);
+    if (spec.kind == Kind::STRING) printf("Bad characters: %zu\n", total.badChars);
+
+    if (total.counted > 0) {
+        const char* what = spec.kind == Kind::STRING ? "Length" : "Value";
+        printf("%s min %g, max %g, mean %g\n", what, total.min, total.max, total.sum / total.counted);
+        // an empty or inverted range has no buckets to show
+        if (spec.limit > spec.low) {
+            size_t biggest = 1;
+            for (size_t b = 0; b < histogramBuckets; b++) biggest = std::max(biggest, total.histogram[b]);
+            double width = (spec.limit - spec.low) / histogramBuckets;
+            for (size_t b = 0; b < histogramBuckets; b++) {
+                printf("  [%10g, %10g) %12zu %s\n", spec.low + b * width, spec.low + (b + 1) * width,
+                        total.histogram[b], std::string(total.histogram[b] * 40 / biggest, '#').c_str());
+            }
+        }
+    }
+    printf("%s\n", ok ? "OK" : "FAILED");
+    return ok;
+}